@@ -0,0 +1,125 @@
+#Provenance keys of a forest production and a cache of finished productions.
+#
+#configHash() identifies the effective configuration of the forest modules and centrality (plus global tag and
+#code version), cacheKey() additionally the input files, lumi mask and number of events. Both are
+#stored in the HiForestInfo tree (ConfigHash, CacheKey), next to the lumi ranges processed from
+#each input file (HiForest/InputFiles).
+#
+#Run as a script, a configuration is only processed if its key is not in the cache yet:
+#   python ForestCache.py hiforestanalyzer_cfg.py <cache directory>
+#otherwise the cached output files are copied to the working directory.
+import glob
+import hashlib
+import os
+import shutil
+import subprocess
+import sys
+
+#modules (and parameter sets) whose configuration defines the forest content;
+#HeavyIonGlobalParameters defines the centrality (hiBin) filled by demo
+forestModules = ['hltanalysis', 'demo', 'HeavyIonGlobalParameters']
+
+def git(args, path):
+    proc = subprocess.Popen(['git'] + args, cwd = path, stdout = subprocess.PIPE, stderr = subprocess.PIPE)
+    out = proc.communicate()[0]
+    if proc.returncode != 0:
+        raise OSError('git %s failed' % ' '.join(args))
+    return out
+
+def text(out):
+    """git output as str (cms.string accepts no unicode under python 2)"""
+    return out if isinstance(out, str) else out.decode()
+
+#sources which are not committed yet still change the build
+uncommittedSources = ['src', 'interface', 'plugins', 'python', 'BuildFile.xml']
+
+def codeVersion(path = '.'):
+    """git describe of the checkout; uncommitted changes add a hash of the changes to '-dirty'."""
+    try:
+        version = text(git(['describe', '--always', '--dirty'], path)).strip()
+        if not version:
+            return 'no git info'
+        if version.endswith('-dirty'):
+            h = hashlib.sha1()
+            h.update(git(['diff', '--binary', 'HEAD'], path))
+            for f in sorted(git(['ls-files', '--others', '--exclude-standard', '-z', '--'] + uncommittedSources, path).split('\0'.encode())):
+                if f:
+                    h.update(f)
+                    h.update(open(os.path.join(path.encode(), f), 'rb').read())
+            version += '-' + h.hexdigest()[:12]
+        return version
+    except OSError:
+        return 'no git info'
+
+def configHash(process, modules = forestModules):
+    h = hashlib.sha1()
+    h.update(process.HiForest.HiForestVersion.value().encode())
+    h.update(str(process.GlobalTag.globaltag.value()).encode())
+    for label in modules:
+        if hasattr(process, label):
+            h.update(label.encode())
+            h.update(getattr(process, label).dumpPython().encode())
+    return h.hexdigest()
+
+def cacheKey(configHash, fileNames, lumis, maxEvents):
+    """Key of a production: configuration hash, input files and lumi mask (a LumiList)."""
+    h = hashlib.sha1()
+    h.update(configHash.encode())
+    h.update(str(maxEvents).encode())
+    for f in fileNames:
+        h.update(f.encode())
+    h.update(str(sorted(lumis.getCompactList().items())).encode())
+    return h.hexdigest()
+
+def outputFiles(process):
+    """Output files written by a job of this configuration (including rotated and resumed ones)."""
+    manifest = process.HiForest.checkpointManifest.value()
+    if manifest and os.path.exists(manifest):
+        import ForestCheckpoint
+        return ForestCheckpoint.readManifest(manifest)[2]
+    name = process.TFileService.fileName.value()
+    base, ext = os.path.splitext(name)
+    return [name] + sorted(glob.glob('%s_[0-9]*%s' % (base, ext)))
+
+def indexFiles(process):
+    """Event indices written by jobs of this configuration (one per attempt when resumed)."""
+    manifest = process.HiForest.checkpointManifest.value()
+    if manifest and os.path.exists(manifest):
+        import ForestCheckpoint
+        indices = ForestCheckpoint.readManifest(manifest)[4]
+    else:
+        indices = [process.HiForest.eventIndex.value()]
+    return [f for f in indices if f and os.path.exists(f)]
+
+def run(config, cacheDir):
+    namespace = {'__file__': config}
+    if sys.version_info[0] < 3:
+        execfile(config, namespace)
+    else:
+        exec(compile(open(config).read(), config, 'exec'), namespace)
+    process = namespace['process']
+    key = process.HiForest.CacheKey.value()
+    if not key:
+        raise SystemExit('%s does not set HiForest.CacheKey' % config)
+    entry = os.path.join(cacheDir, key)
+    if os.path.isdir(entry):
+        print('Cache hit %s: copying cached output' % key)
+        for f in sorted(os.listdir(entry)):
+            shutil.copy(os.path.join(entry, f), f)
+        return 0
+    status = subprocess.call(['cmsRun', config])
+    if status != 0:
+        return status
+    #fill a temporary directory first, an entry only exists once it is complete
+    tmp = entry + '.tmp%d' % os.getpid()
+    os.makedirs(tmp)
+    for f in outputFiles(process) + indexFiles(process):
+        shutil.copy(f, tmp)
+    os.rename(tmp, entry)
+    print('Cached output as %s' % key)
+    return 0
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        raise SystemExit('usage: python ForestCache.py <configuration> <cache directory>')
+    sys.exit(run(sys.argv[1], sys.argv[2]))
@@ -0,0 +1,67 @@
+#Resuming of interrupted forest production from the HiForestInfo checkpoint manifest.
+#
+#With process.HiForest.checkpointManifest set, the forest output is committed at every
+#lumi section boundary and the manifest lists what the committed output contains:
+#   output <file>        output file written by a job (also each new file of the output rotation)
+#   key <CacheKey>       production key of the job (configuration and inputs), one line per job
+#   index <file>         event index written by a job
+#   lumi <run> <lumi>    lumi section fully contained in the committed output
+#   file <name>          input file fully contained in the committed output
+#   done                 job finished normally (informative, resuming only looks at the lumis)
+#resume() uses it to restrict a rerun of the same configuration to what is still missing.
+#A job stopped by maxEvents still ends its last lumi section, which then looks complete although
+#the rest of its events were never read: checkpointing is only possible with maxEvents = -1.
+import os
+import PhysicsTools.PythonAnalysis.LumiList as LumiList
+
+def readManifest(manifest):
+    lumis = []
+    files = set()
+    outputs = []
+    keys = set()
+    indices = []
+    attempts = 0
+    for line in open(manifest):
+        words = line.split()
+        #the last line may be incomplete if the job was killed while writing it
+        if not line.endswith('\n') or not words:
+            continue
+        if words[0] == 'lumi' and len(words) == 3:
+            lumis.append((int(words[1]), int(words[2])))
+        elif words[0] == 'file' and len(words) == 2:
+            files.add(words[1])
+        elif words[0] == 'output' and len(words) == 2:
+            outputs.append(words[1])
+        elif words[0] == 'key':
+            attempts += 1
+            if len(words) == 2:
+                keys.add(words[1])
+        elif words[0] == 'index' and len(words) == 2:
+            indices.append(words[1])
+    return lumis, files, outputs, keys, indices, attempts
+
+def resume(manifest, goodLumis, fileNames, outputFile, maxEvents, cacheKey):
+    """Return (lumis, fileNames, outputFile) still to be processed given the manifest of previous attempts.
+
+    goodLumis is the LumiList of the full job, fileNames its input files. Each attempt writes its
+    own output file (outputFile with a '_resume<N>' suffix for the N-th restart, N being the
+    number of jobs in the manifest), so outputs of earlier attempts are kept; their committed
+    content is what the manifest lists. Attempts with a different cacheKey (configuration, code
+    or inputs changed) are not resumed.
+    """
+    if maxEvents != -1:
+        raise SystemExit('checkpointing (%s) needs maxEvents = -1, not %d' % (manifest, maxEvents))
+    if not os.path.exists(manifest):
+        return goodLumis, fileNames, outputFile
+    lumis, files, outputs, keys, indices, attempts = readManifest(manifest)
+    if keys and keys != set([cacheKey]):
+        raise SystemExit('%s was written with a different configuration or input (CacheKey %s, now %s), remove it to start from scratch'
+                         % (manifest, ' '.join(sorted(keys)), cacheKey))
+    remaining = goodLumis - LumiList.LumiList(lumis = lumis)
+    if not remaining.getCompactList():
+        raise SystemExit('%s: all requested lumi sections are already processed' % manifest)
+    fileNames = [f for f in fileNames if f not in files]
+    base, ext = os.path.splitext(outputFile)
+    outputFile = '%s_resume%d%s' % (base, attempts, ext)
+    print('Resuming from %s: %d lumi sections and %d input files already done, writing %s' % (manifest, len(lumis), len(files), outputFile))
+    return remaining, fileNames, outputFile
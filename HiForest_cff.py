@@ -3,5 +3,14 @@ import FWCore.ParameterSet.Config as cms
 HiForest = cms.EDAnalyzer("HiForestInfo",
                           HiForestVersion = cms.string(""),
                           GlobalTagLabel = cms.string(""),
-                          inputLines = cms.vstring("",)
+                          inputLines = cms.vstring("",),
+                          ConfigHash = cms.string(""), #hash of the forest module configuration (ForestCache.configHash)
+                          CacheKey = cms.string(""), #key of the production: configuration and inputs (ForestCache.cacheKey)
+                          checkpointManifest = cms.untracked.string(""), #commit output at each lumi and list it here ('' = off)
+                          #start a new output file (<name>_1.root, <name>_2.root, ...) at the first lumi boundary
+                          #after one of these limits is reached (0 = no limit)
+                          maxFileSize = cms.untracked.int32(0), #MB
+                          maxEventsPerFile = cms.untracked.int32(0),
+                          maxLumisPerFile = cms.untracked.int32(0),
+                          eventIndex = cms.untracked.string("") #write (run, lumi, event) -> input file index here ('' = off), see pickEvents.py
 )
@@ -14,7 +14,7 @@ scram b -j8
 if [ -z "$1" ]; then nev=100; else nev=$1; fi
 if [ -z "$2" ]; then config=hiforestanalyzer_cfg.py; else config=$2; fi
 # set the number of events
-eventline=$(grep maxEvents $config)
+eventline=$(grep '^process.maxEvents = ' $config)
 sed -i "s/$eventline/process.maxEvents = cms.untracked.PSet( input = cms.untracked.int32($nev) )/g" $config
 # remove the connection to cvmfs, for GT access from docker container  
 sed -i "s/process.GlobalTag.connect/#process.GlobalTag.connect/g" $config
@@ -8,23 +8,20 @@ process.options = cms.untracked.PSet(SkipEvent = cms.untracked.vstring('ProductN
 
 #Number of events: put '-1' unless testing
 process.maxEvents = cms.untracked.PSet( input = cms.untracked.int32(100) )
+nEvents = process.maxEvents.input.value()
 
 #HiForest script init
 process.load("HiForest_cff")
 process.HiForest.inputLines = cms.vstring("HiForest V3",)
-version = 'no git info'
+import ForestCache
+version = ForestCache.codeVersion() #'no git info' outside of a git checkout
 process.HiForest.HiForestVersion = cms.string(version)
 
 goodJSON = 'Cert_181530-183126_HI7TeV_PromptReco_Collisions11_JSON_MuonPhys.txt'
-myLumis = LumiList.LumiList(filename = goodJSON).getCMSSWString().split(',')
+goodLumis = LumiList.LumiList(filename = goodJSON)
 import FWCore.Utilities.FileUtils as FileUtils
 files2011data = FileUtils.loadListFromFile ('CMS_HIRun2011_HIDiMuon_RECO_04Mar2013-v1_root_file_index.txt')
-process.source = cms.Source("PoolSource",
-    fileNames = cms.untracked.vstring(*files2011data    
-    )
-)
-process.source.lumisToProcess = CfgTypes.untracked(CfgTypes.VLuminosityBlockRange())
-process.source.lumisToProcess.extend(myLumis)
+outputFile = "HiForestAOD_DATAtest2011.root" #change each run not to overwrite previous output
 
 #Global Tag: change the name according to the instructions
 process.load('Configuration.StandardSequences.FrontierConditions_GlobalTag_cff')
@@ -34,9 +31,13 @@ process.load('FWCore.MessageService.MessageLogger_cfi')
 process.load("Configuration.StandardSequences.MagneticField_cff")
 process.HiForest.GlobalTagLabel = process.GlobalTag.globaltag
 
-#Define the output root file (change each run not to overwrite previous output)
-process.TFileService = cms.Service("TFileService",
-                                   fileName=cms.string("HiForestAOD_DATAtest2011.root"))
+#Centrality: hiBin from the HF tower centrality table (40 bins of 2.5% for 2011) of the global tag (HeavyIonRcd)
+process.HeavyIonGlobalParameters = cms.PSet(
+    centralityVariable = cms.string("HFtowers"),
+    nonDefaultGlauberModel = cms.string(""),
+    centralitySrc = cms.InputTag("hiCentrality")
+)
+
 
 #Init Trigger Analyzer
 process.hltanalysis = cms.EDAnalyzer('TriggerInfoAnalyzer',
@@ -48,7 +49,43 @@ process.hltanalysis = cms.EDAnalyzer('TriggerInfoAnalyzer',
                               )
 
 #Collect event data
-process.demo = cms.EDAnalyzer('Analyzer') #present analyzer is for muons - see details in Analyzer.cc for possible modifications
+process.demo = cms.EDAnalyzer('Analyzer', #present analyzer is for muons - see details in Analyzer.cc for possible modifications
+                              dropColumns = cms.untracked.vstring(), #columns not written to the Muons tree, e.g. "muIso*", "muDistPVz"
+                              #fill hiBin and HF energy sums (hiHF, hiHFplus, hiHFminus); needs hiCentrality and the HeavyIonRcd
+                              #centrality table, events without them get hiBin = -1
+                              centrality = cms.untracked.bool(False),
+                              #hiBin edges of centrality classes: if given, events are written to one tree per class
+                              #(Muons_hiBin<low>to<high>) instead of Muons, with evSeq giving the entry in HltTree; hiBin below
+                              #the first or above the last edge (also -1) goes to the first or last class, the tree user info
+                              #(hiBinLow, hiBinHigh) gives the bounds of the hiBin values in each tree
+                              centralityPartition = cms.untracked.vint32(),
+                              histogramMode = cms.untracked.bool(False), #True: fill the histograms below in the job instead of the Muons tree
+                              #dimuon selection used in histogram mode (same as in forest2dimuon.C)
+                              dimuonSelection = cms.PSet(
+                                  triggerName = cms.string("HLT_HIL2Mu3_NHitQ_v1"), #'' for no trigger requirement
+                                  triggerResults = cms.InputTag("TriggerResults","","HLT"),
+                                  minHitsValid = cms.int32(12),
+                                  minHitsPixel = cms.int32(2),
+                                  maxTrackChi2NDOF = cms.double(4.0),
+                                  maxDistPV0 = cms.double(0.05),
+                                  minPt = cms.double(1.4),
+                                  maxAbsEta = cms.double(2.4)
+                              ),
+                              #mixed event background in histogram mode (histograms <name>_mix): each event is mixed with the
+                              #last 'depth' events of the same vertex z and centrality (or, without centrality, muon multiplicity Nmu) bin
+                              #(depth 0: no mixing, events without primary vertex are never mixed; as in forest2dimuon.C)
+                              dimuonMixing = cms.PSet(
+                                  depth = cms.int32(0),
+                                  zBins = cms.vdouble(-15., -10., -5., 0., 5., 10., 15.),
+                                  centralityBins = cms.vdouble(0., 2., 4., 8., 12., 16., 20., 28., 40.),
+                                  multiplicityBins = cms.vdouble(0., 2., 3., 4., 6., 1000.)
+                              ),
+                              #histograms of opposite sign dimuons; variable is 'mass', 'pt' or 'rapidity'
+                              histograms = cms.VPSet(
+                                  cms.PSet(name = cms.string("dimu_h"), title = cms.string("dimu_h;M_{Inv} [GeV];Events"), variable = cms.string("mass"),
+                                           nbins = cms.int32(50), min = cms.double(0.), max = cms.double(10.))
+                              )
+                              )
 process.dump=cms.EDAnalyzer('EventContentAnalyzer') #easy check of Event structure and names without using the TBrowser
 
 process.ana_step = cms.Path(process.hltanalysis+
@@ -57,3 +94,41 @@ process.ana_step = cms.Path(process.hltanalysis+
                             process.HiForest 
 )
 
+#Quick look: fill the dimuon histograms in the job (demo/dimu_h) instead of writing the forest trees
+quickLook = False
+if quickLook:
+    process.demo.histogramMode = cms.untracked.bool(True)
+    process.ana_step = cms.Path(process.demo+process.HiForest)
+
+#Provenance: hash of the forest module configuration and key of this production (configuration
+#and inputs), see ForestCache.py. The key does not change when a job resumes from its checkpoint,
+#a checkpoint written with a different key is not resumed.
+process.HiForest.ConfigHash = cms.string(ForestCache.configHash(process))
+process.HiForest.CacheKey = cms.string(ForestCache.cacheKey(process.HiForest.ConfigHash.value(), files2011data,
+                                                            goodLumis, nEvents))
+
+#Checkpointing: output is committed at each lumi section and listed in this manifest.
+#Rerunning this configuration in the same directory then only processes what is missing
+#(into a new output file). Remove the manifest to start from scratch, put '' to disable.
+#Test runs with a limited number of events are not checkpointed.
+checkpoint = 'HiForest_checkpoint.txt'
+if nEvents != -1:
+    checkpoint = ''
+if checkpoint:
+    import ForestCheckpoint
+    goodLumis, files2011data, outputFile = ForestCheckpoint.resume(checkpoint, goodLumis, files2011data, outputFile, nEvents,
+                                                                   process.HiForest.CacheKey.value())
+process.HiForest.checkpointManifest = cms.untracked.string(checkpoint)
+myLumis = goodLumis.getCMSSWString().split(',')
+process.source = cms.Source("PoolSource",
+    fileNames = cms.untracked.vstring(*files2011data    
+    )
+)
+process.source.lumisToProcess = CfgTypes.untracked(CfgTypes.VLuminosityBlockRange())
+process.source.lumisToProcess.extend(myLumis)
+
+#Define the output root file
+process.TFileService = cms.Service("TFileService",
+                                   fileName=cms.string(outputFile))
+#Event index next to the output: input file of each event, for picking RECO events with pickEvents.py
+process.HiForest.eventIndex = cms.untracked.string(outputFile.replace('.root', '.evidx'))
@@ -0,0 +1,152 @@
+#ifndef HiForestProducer_DimuonMixer_h
+#define HiForestProducer_DimuonMixer_h
+
+// Event mixing for the combinatorial dimuon background.
+//
+// Selected muons of past events are kept in pools, one per bin of primary
+// vertex z and event class (multiplicity or centrality). Each pool is a ring
+// buffer holding the muons of the last 'depth' events of its bin. The muons
+// of a new event are paired with all muons in its pool, then the event
+// replaces the oldest one of the pool:
+//
+//   mixer.beginEvent(pvZ, eventClass);
+//   for (selected muons) mixer.addMuon(forest::MixMuon::fromPtEtaPhi(pt, eta, phi, mass, charge));
+//   mixer.mix(filler);    // filler(const MixMuon&, const MixMuon&) for each opposite sign pair
+//   mixer.endEvent();
+//
+// All storage is allocated in the constructor, muons are stored as
+// (px, py, pz, E) in one contiguous array, so mixing is a linear scan without
+// trigonometric functions and nothing is allocated per event. A mixer has no
+// static or shared state: parallel jobs/threads each use their own mixer.
+//
+// The header does not depend on CMSSW, it is also used by forest2dimuon.C.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace forest {
+
+struct MixMuon {
+  float px, py, pz, e;
+  int charge;
+
+  static MixMuon fromPtEtaPhi(double pt, double eta, double phi, double mass, int charge)
+  {
+    MixMuon mu;
+    mu.px = pt * std::cos(phi);
+    mu.py = pt * std::sin(phi);
+    mu.pz = pt * std::sinh(eta);
+    mu.e = std::sqrt(mu.px * mu.px + mu.py * mu.py + mu.pz * mu.pz + mass * mass);
+    mu.charge = charge;
+    return mu;
+  }
+};
+
+// dimuon variables
+inline double pairMass(const MixMuon& a, const MixMuon& b)
+{
+  double e = a.e + b.e, px = a.px + b.px, py = a.py + b.py, pz = a.pz + b.pz;
+  double m2 = e * e - px * px - py * py - pz * pz;
+  return m2 > 0 ? std::sqrt(m2) : 0;
+}
+
+inline double pairPt(const MixMuon& a, const MixMuon& b)
+{
+  double px = a.px + b.px, py = a.py + b.py;
+  return std::sqrt(px * px + py * py);
+}
+
+inline double pairRapidity(const MixMuon& a, const MixMuon& b)
+{
+  double e = a.e + b.e, pz = a.pz + b.pz;
+  return 0.5 * std::log((e + pz) / (e - pz));
+}
+
+class DimuonMixer {
+ public:
+  // zEdges/classEdges: bin edges (n+1 values for n bins, increasing); events
+  // outside of them are neither mixed nor stored. depth: events per pool,
+  // maxMuons: muons kept per event
+  DimuonMixer(const std::vector<double>& zEdges, const std::vector<double>& classEdges, int depth, int maxMuons)
+    : _zEdges(zEdges), _classEdges(classEdges), _depth(depth), _maxMuons(maxMuons), _bin(-1), _nCurrent(0)
+  {
+    int nBins = nZBins() * nClassBins();
+    _muons.resize(nBins * _depth * _maxMuons);
+    _counts.assign(nBins * _depth, 0);
+    _head.assign(nBins, 0);
+    _filled.assign(nBins, 0);
+    _current.resize(_maxMuons);
+  }
+
+  int nZBins() const { return std::max(int(_zEdges.size()) - 1, 0); }
+  int nClassBins() const { return std::max(int(_classEdges.size()) - 1, 0); }
+  int depth() const { return _depth; }
+  // number of events in the pool of the current event
+  int poolSize() const { return _bin < 0 ? 0 : _filled[_bin]; }
+
+  void beginEvent(double z, double eventClass)
+  {
+    int zBin = findBin(_zEdges, z);
+    int classBin = findBin(_classEdges, eventClass);
+    _bin = (zBin < 0 || classBin < 0) ? -1 : zBin * nClassBins() + classBin;
+    _nCurrent = 0;
+  }
+
+  // muons beyond maxMuons are ignored
+  void addMuon(const MixMuon& mu)
+  {
+    if (_nCurrent < _maxMuons)
+      _current[_nCurrent++] = mu;
+  }
+
+  // call fill(current muon, pooled muon) for all opposite sign pairs of the
+  // current event with the pooled events
+  template <class Filler>
+  void mix(Filler& fill) const
+  {
+    if (_bin < 0) return;
+    for (int ev = 0; ev < _filled[_bin]; ev++) {
+      int slot = _bin * _depth + ev;
+      const MixMuon* pooled = &_muons[slot * _maxMuons];
+      for (int i = 0; i < _nCurrent; i++)
+        for (int j = 0; j < _counts[slot]; j++)
+          if (_current[i].charge * pooled[j].charge < 0)
+            fill(_current[i], pooled[j]);
+    }
+  }
+
+  // store the current event in its pool (replacing the oldest one when full)
+  void endEvent()
+  {
+    if (_bin < 0 || _nCurrent == 0 || _depth <= 0) return;
+    int slot = _bin * _depth + _head[_bin];
+    std::copy(_current.begin(), _current.begin() + _nCurrent, _muons.begin() + slot * _maxMuons);
+    _counts[slot] = _nCurrent;
+    _head[_bin] = (_head[_bin] + 1) % _depth;
+    if (_filled[_bin] < _depth) _filled[_bin]++;
+  }
+
+ private:
+  static int findBin(const std::vector<double>& edges, double x)
+  {
+    if (edges.size() < 2 || x < edges.front() || x >= edges.back()) return -1;
+    return int(std::upper_bound(edges.begin(), edges.end(), x) - edges.begin()) - 1;
+  }
+
+  std::vector<double> _zEdges;
+  std::vector<double> _classEdges;
+  int _depth;
+  int _maxMuons;
+  std::vector<MixMuon> _muons;  // [bin][event slot][muon]
+  std::vector<int> _counts;     // muons per [bin][event slot]
+  std::vector<int> _head;       // next slot to overwrite per bin
+  std::vector<int> _filled;     // events stored per bin
+  int _bin;                     // pool of the current event (-1: none)
+  int _nCurrent;
+  std::vector<MixMuon> _current;
+};
+
+} // namespace forest
+
+#endif
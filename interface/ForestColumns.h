@@ -0,0 +1,181 @@
+#ifndef HiForestProducer_ForestColumns_h
+#define HiForestProducer_ForestColumns_h
+
+// Declarative column registry for the forest output trees.
+//
+// Each output column is declared once as a member of the analyzer, e.g.
+//
+//   forest::ColumnRegistry _columns;
+//   forest::Scalar<int> _Nmu;
+//   forest::Array<float, 10> _muPt;
+//
+// and given its branch name in the constructor initialiser list:
+//
+//   _Nmu(_columns, "Nmu"), _muPt(_columns, _Nmu, "muPt")
+//
+// The registry then creates the branches (leaf lists such as "muPt[Nmu]/F"
+// are derived from the column type), resets every column to its default at
+// the start of each event and lets the configuration drop columns that an
+// analysis does not need. Dropped columns are still valid in memory (so the
+// filling code does not change), they just never reach the tree.
+//
+// Note: the registry keeps plain pointers to the columns, so it has to be
+// declared before them in the owning class.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "TTree.h"
+
+namespace forest {
+
+// ROOT leaf type code for each supported column type
+template <typename T> struct LeafType;
+template <> struct LeafType<int>      { static const char* code() { return "I"; } };
+template <> struct LeafType<unsigned> { static const char* code() { return "i"; } };
+template <> struct LeafType<float>    { static const char* code() { return "F"; } };
+template <> struct LeafType<double>   { static const char* code() { return "D"; } };
+
+class ColumnRegistry;
+
+// common part of all columns: name, enabled flag and the per-event reset
+class ColumnBase {
+ public:
+  virtual ~ColumnBase() {}
+
+  const std::string& name() const { return _name; }
+  bool enabled() const { return _enabled; }
+  void setEnabled(bool enabled) { _enabled = enabled; }
+
+  // column which has to be written whenever this one is (array counter), or 0
+  virtual ColumnBase* dependency() const { return 0; }
+  virtual void book(TTree* tree) = 0;
+  virtual void reset() = 0;
+
+ protected:
+  inline ColumnBase(ColumnRegistry& registry, const std::string& name);
+
+ private:
+  // columns are owned by the analyzer and point into its memory: no copies
+  ColumnBase(const ColumnBase&);
+  ColumnBase& operator=(const ColumnBase&);
+
+  std::string _name;
+  bool _enabled;
+};
+
+// keeps track of all columns of one tree
+class ColumnRegistry {
+ public:
+  void add(ColumnBase* column) { _columns.push_back(column); }
+
+  // enable or disable all columns matching pattern (exact name, or prefix
+  // followed by '*'); returns the number of matched columns
+  int setEnabled(const std::string& pattern, bool enabled)
+  {
+    int matched = 0;
+    for (unsigned i = 0; i < _columns.size(); i++)
+      if (matches(pattern, _columns[i]->name()))
+      {
+        _columns[i]->setEnabled(enabled);
+        matched++;
+      }
+    return matched;
+  }
+
+  // create branches for all enabled columns (in declaration order, so that
+  // array counters are booked before the arrays using them)
+  void book(TTree* tree)
+  {
+    for (unsigned i = 0; i < _columns.size(); i++)
+    {
+      ColumnBase* dep = _columns[i]->dependency();
+      if (_columns[i]->enabled() && dep)
+        dep->setEnabled(true);
+    }
+    for (unsigned i = 0; i < _columns.size(); i++)
+      if (_columns[i]->enabled())
+        _columns[i]->book(tree);
+  }
+
+  // set all columns (enabled or not) to their default values
+  void reset()
+  {
+    for (unsigned i = 0; i < _columns.size(); i++)
+      _columns[i]->reset();
+  }
+
+  unsigned size() const { return _columns.size(); }
+  const ColumnBase& operator[](unsigned i) const { return *_columns[i]; }
+
+  static bool matches(const std::string& pattern, const std::string& name)
+  {
+    if (!pattern.empty() && pattern[pattern.size() - 1] == '*')
+      return name.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0;
+    return pattern == name;
+  }
+
+ private:
+  std::vector<ColumnBase*> _columns;
+};
+
+inline ColumnBase::ColumnBase(ColumnRegistry& registry, const std::string& name)
+  : _name(name), _enabled(true)
+{
+  registry.add(this);
+}
+
+// one value per event (also used as counter of array columns)
+template <typename T>
+class Scalar : public ColumnBase {
+ public:
+  Scalar(ColumnRegistry& registry, const std::string& name, T init = T())
+    : ColumnBase(registry, name), _value(init), _init(init) {}
+
+  operator T() const { return _value; }
+  Scalar& operator=(T value) { _value = value; return *this; }
+  Scalar& operator++() { ++_value; return *this; }
+  T operator++(int) { return _value++; }
+
+  void book(TTree* tree)
+  {
+    tree->Branch(name().c_str(), &_value, (name() + "/" + LeafType<T>::code()).c_str());
+  }
+  void reset() { _value = _init; }
+
+ private:
+  T _value;
+  T _init;
+};
+
+// variable-length array with at most N entries per event, its length given
+// by a counter column
+template <typename T, int N>
+class Array : public ColumnBase {
+ public:
+  static const int capacity = N;
+
+  Array(ColumnRegistry& registry, Scalar<int>& counter, const std::string& name, T init = T())
+    : ColumnBase(registry, name), _counter(counter), _init(init) { reset(); }
+
+  T& operator[](int i) { return _values[i]; }
+  const T& operator[](int i) const { return _values[i]; }
+
+  ColumnBase* dependency() const { return &_counter; }
+  void book(TTree* tree)
+  {
+    tree->Branch(name().c_str(), _values,
+                 (name() + "[" + _counter.name() + "]/" + LeafType<T>::code()).c_str());
+  }
+  void reset() { std::fill(_values, _values + N, _init); }
+
+ private:
+  Scalar<int>& _counter;
+  T _values[N];
+  T _init;
+};
+
+} // namespace forest
+
+#endif
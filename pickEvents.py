@@ -0,0 +1,131 @@
+#Configuration for picking events from RECO with the event indices written by HiForestInfo.
+#
+#With process.HiForest.eventIndex set, a forest job writes the input file of each of its events
+#(all numbers little endian):
+#   "HFEVIDX1", followed by segments of
+#     uint32 number of new input files, per file: uint32 name length, name
+#     uint32 number of events, per event: uint32 run, lumi, event, input file number (16 bytes),
+#     sorted by (run, event, lumi)
+#Input files are numbered over all segments. A finished job writes a single segment, a job that was
+#interrupted leaves one segment per committed lumi section (a truncated last one is ignored).
+#The indices are memory mapped and each segment is binary searched, so only the requested events are read.
+#
+#   python pickEvents.py events.txt HiForestAOD_DATAtest2011.evidx [more indices] > pick_cfg.py
+#   cmsRun pick_cfg.py
+#events.txt has one event per line as run:lumi:event or run:event. The configuration reads only
+#the input files containing these events and writes them to pickevents.root.
+import mmap
+import struct
+import sys
+
+magic = 'HFEVIDX1'.encode()
+count = struct.Struct('<I')
+record = struct.Struct('<IIII')
+
+class EventIndex:
+    def __init__(self, fileName):
+        f = open(fileName, 'rb')
+        self.data = mmap.mmap(f.fileno(), 0, access = mmap.ACCESS_READ)
+        f.close()
+        if self.data[:len(magic)] != magic:
+            raise SystemExit('%s is not an event index' % fileName)
+        self.files = []
+        self.segments = [] #(offset of the first event, number of events)
+        size = len(self.data)
+        offset = len(magic)
+        while offset + count.size <= size:
+            nFiles = count.unpack_from(self.data, offset)[0]
+            offset += count.size
+            files = []
+            for i in range(nFiles):
+                if offset + count.size > size:
+                    break
+                length = count.unpack_from(self.data, offset)[0]
+                if offset + count.size + length > size:
+                    break
+                files.append(self.data[offset + count.size:offset + count.size + length].decode())
+                offset += count.size + length
+            if len(files) < nFiles or offset + count.size > size:
+                break
+            nEvents = count.unpack_from(self.data, offset)[0]
+            offset += count.size
+            if offset + nEvents * record.size > size:
+                break
+            self.files += files
+            self.segments.append((offset, nEvents))
+            offset += nEvents * record.size
+
+    def event(self, start, i):
+        return record.unpack_from(self.data, start + i * record.size)
+
+    def find(self, run, event, lumi = None):
+        """Input files containing the event (lumi None: any lumi section)."""
+        files = []
+        for start, nEvents in self.segments:
+            lo, hi = 0, nEvents
+            while lo < hi:
+                mid = (lo + hi) // 2
+                r = self.event(start, mid)
+                if (r[0], r[2]) < (run, event):
+                    lo = mid + 1
+                else:
+                    hi = mid
+            while lo < nEvents:
+                r = self.event(start, lo)
+                if (r[0], r[2]) != (run, event):
+                    break
+                if (lumi is None or r[1] == lumi) and self.files[r[3]] not in files:
+                    files.append(self.files[r[3]])
+                lo += 1
+        return files
+
+def readEvents(fileName):
+    events = []
+    for line in open(fileName):
+        line = line.split('#')[0].strip()
+        if not line:
+            continue
+        ids = [int(x) for x in line.split(':')]
+        if len(ids) == 3:
+            events.append((ids[0], ids[2], ids[1]))
+        elif len(ids) == 2:
+            events.append((ids[0], ids[1], None))
+        else:
+            raise SystemExit('%s: bad event "%s", use run:lumi:event or run:event' % (fileName, line))
+    return events
+
+def pickConfig(events, indices, output = 'pickevents.root'):
+    fileNames = []
+    ranges = []
+    for run, event, lumi in events:
+        found = []
+        for index in indices:
+            found += index.find(run, event, lumi)
+        if not found:
+            sys.stderr.write('event %d:%d not in the indices, skipped\n' % (run, event))
+            continue
+        #the same event may be in several files (duplicates in the dataset), all are read
+        for f in found:
+            if f not in fileNames:
+                fileNames.append(f)
+        ranges.append('%d:%d' % (run, event))
+    lines = ['import FWCore.ParameterSet.Config as cms',
+             'process = cms.Process("PICK")',
+             'process.source = cms.Source("PoolSource",',
+             '    fileNames = cms.untracked.vstring(',
+             ] + ["        '%s'," % f for f in fileNames] + [
+             '    ),',
+             '    eventsToProcess = cms.untracked.VEventRange(',
+             ] + ['        %r,' % r for r in ranges] + [
+             '    )',
+             ')',
+             'process.out = cms.OutputModule("PoolOutputModule", fileName = cms.untracked.string(%r))' % output,
+             'process.e = cms.EndPath(process.out)',
+             '']
+    return '\n'.join(lines)
+
+if __name__ == '__main__':
+    if len(sys.argv) < 3:
+        raise SystemExit('usage: python pickEvents.py <event list> <event index> [<event index> ...]')
+    indices = [EventIndex(f) for f in sys.argv[2:]]
+    sys.stdout.write(pickConfig(readEvents(sys.argv[1]), indices))
@@ -8,6 +8,7 @@ cd HiForest
 mkdir HiForestProducer
 cd HiForestProducer
 cp /mnt/vol/forest2dimuon.C .
+cp -r /mnt/vol/interface .
 
 cp /mnt/vol/*.root .
 root -l -b forest2dimuon.C++
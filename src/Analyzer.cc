@@ -40,17 +40,53 @@
 //for beamspot information
 #include "DataFormats/BeamSpot/interface/BeamSpot.h"
 
+// for centrality (needs HeavyIonGlobalParameters in the configuration)
+#include "DataFormats/HeavyIonEvent/interface/CentralityProvider.h"
+
 // triggers
 #include "DataFormats/Common/interface/TriggerResults.h"
 #include "HLTrigger/HLTcore/interface/HLTConfigProvider.h"
+#include "FWCore/Common/interface/TriggerNames.h"
+#include "FWCore/Utilities/interface/Exception.h"
 
 // ROOT
 #include <TLorentzVector.h>
 #include <TFile.h>
 #include <TTree.h>
 
-#include <TTree.h>
 #include <TDirectory.h>
+#include <TH1F.h>
+#include <TParameter.h>
+
+// STL
+#include <algorithm>
+#include <limits>
+
+// output columns
+#include "HiForest/HiForestProducer/interface/ForestColumns.h"
+// event mixing
+#include "HiForest/HiForestProducer/interface/DimuonMixer.h"
+
+// dimuon histograms of the histogram mode: fills each histogram with its
+// variable of a muon pair (same event or mixed)
+enum DimuonVariable { kDimuMass, kDimuPt, kDimuRapidity };
+struct DimuonHistFiller {
+  std::vector<TH1F*> hists;
+  std::vector<DimuonVariable> variables;
+
+  void operator()(const forest::MixMuon& a, const forest::MixMuon& b)
+  {
+    for(unsigned h = 0; h < hists.size(); h++)
+    {
+      switch(variables[h])
+      {
+        case kDimuMass: hists[h]->Fill(forest::pairMass(a, b)); break;
+        case kDimuPt: hists[h]->Fill(forest::pairPt(a, b)); break;
+        case kDimuRapidity: hists[h]->Fill(forest::pairRapidity(a, b)); break;
+      }
+    }
+  }
+};
 
 //
 // class declaration
@@ -83,9 +119,16 @@ class Analyzer : public edm::EDAnalyzer {
 // relative input tag used in the analyzer function.
    //   int SelectEl(const edm::Handle<reco::GsfElectronCollection>& electrons, const reco::VertexCollection::const_iterator& pv);
       int SelectPrimaryVertex(const edm::Handle<reco::VertexCollection>& primVertex);
+      int SelectCentrality(const edm::Event& iEvent, const edm::EventSetup& iSetup);
+      TTree* PartitionTree();
       const reco::Candidate* GetFinalState(const reco::Candidate* particle, const int id);
       void FillFourMomentum(const reco::Candidate* particle, float* p);
       void InitBranchVars();
+      // histogram mode routines
+      void BookDimuonHists(const edm::ParameterSet& iConfig);
+      bool PassTrigger(const edm::Event& iEvent);
+      bool PassDimuonMu(int i);
+      void FillDimuonHists();
 
       // input tags
       edm::InputTag _inputTagMuons;
@@ -105,48 +148,70 @@ class Analyzer : public edm::EDAnalyzer {
       // storage
       TFile* _file;
       TTree* _tree;
+
+      // histogram mode: the dimuon selection of forest2dimuon.C is applied in the job
+      // and only the histograms are written (no Muons tree)
+      bool _histogramMode;
+      std::string _triggerName;
+      edm::InputTag _inputTagTriggerResults;
+      int _muMinHitsValid;
+      int _muMinHitsPixel;
+      double _muMaxTrackChi2NDOF;
+      double _muMaxDistPV0;
+      double _muMinPt;
+      double _muMaxAbsEta;
+      // centrality
+      int _flagCentrality;
+      CentralityProvider* _centrality;
+      int _nCentralityMissing; // events without centrality product or table (hiBin = -1)
+      // centrality partitioned output: one tree per class of hiBin, classes
+      // [edge_i, edge_i+1); hiBin below/above the edges (also -1, no centrality)
+      // goes to the first/last class, whose recorded bounds include these
+      std::vector<int> _partitionEdges;
+      std::vector<TTree*> _partitionTrees;
+
+      DimuonHistFiller _dimuHists;
+      // mixed event background (histograms <name>_mix), 0 if not configured
+      DimuonHistFiller _dimuMixHists;
+      forest::DimuonMixer* _mixer;
       
       // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
       // >>>>>>>>>>>>>>>> event variables >>>>>>>>>>>>>>>>>>>>>>>
       // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
-      // (their description given when tree branches are created)
+      // Every tree column is declared once here and named in the constructor;
+      // the registry books, resets and (via 'dropColumns') slims them.
+      // It has to stay in front of the columns it keeps track of.
+      forest::ColumnRegistry _columns;
       // event
-      int _evRunNumber;
-      int _evEventNumber;
+      forest::Scalar<int> _evRunNumber; // run number
+      forest::Scalar<int> _evEventNumber; // event number
+      forest::Scalar<int> _evSeq; // entry of the event in the unpartitioned trees (HltTree), written with centralityPartition only
       // muons
       static const int _maxNmu = 10;
-      int _Nmu;
+      forest::Scalar<int> _Nmu; // number of muons
       int _Nmu0;
-      float _muPt[_maxNmu];
-      float _muEta[_maxNmu];
-      float _muPhi[_maxNmu];
-      float _muC[_maxNmu];
-      float _muIso03[_maxNmu];
-      float _muIso04[_maxNmu];
-      int _muHitsValid[_maxNmu];
-      int _muHitsPixel[_maxNmu];
-      float _muDistPV0[_maxNmu];
-      float _muDistPVz[_maxNmu];
-      float _muTrackChi2NDOF[_maxNmu];
-      // electrons
-      static const int _maxNel = 10;
-      int _Nel;
-      float _elPt[_maxNel];
-      float _elEta[_maxNel];
-      float _elPhi[_maxNel];
-      float _elIso03[_maxNel];
-      float _elIso04[_maxNel];
-      int _elConvFlag[_maxNel];
-      float _elConvDist[_maxNel];
-      float _elConvDcot[_maxNel];
-      float _elMissHits[_maxNel];
-      float _elDistPV0[_maxNel];
-      float _elDistPVz[_maxNel];
+      forest::Array<float, _maxNmu> _muPt; // muon pT
+      forest::Array<float, _maxNmu> _muEta; // muon pseudorapidity
+      forest::Array<float, _maxNmu> _muPhi; // muon phi
+      forest::Array<float, _maxNmu> _muC; // muon charge
+      forest::Array<float, _maxNmu> _muIso03; // muon isolation, delta_R=0.3
+      forest::Array<float, _maxNmu> _muIso04; // muon isolation, delta_R=0.4
+      forest::Array<int, _maxNmu> _muHitsValid; // muon valid hits number
+      forest::Array<int, _maxNmu> _muHitsPixel; // muon pixel hits number
+      forest::Array<float, _maxNmu> _muDistPV0; // muon distance to the primary vertex (projection on transverse plane)
+      forest::Array<float, _maxNmu> _muDistPVz; // muon distance to the primary vertex (z projection)
+      forest::Array<float, _maxNmu> _muTrackChi2NDOF; // muon track chi2 / number of degrees of freedom
+      // electrons: add an 'el' collection here (counter + arrays) when implemented
       // primary vertex
-      int _Npv;
-      int _pvNDOF;
-      float _pvZ;
-      float _pvRho;
+      forest::Scalar<int> _Npv; // total number of primary vertices
+      forest::Scalar<int> _pvNDOF; // number of degrees of freedom of the primary vertex
+      forest::Scalar<float> _pvZ; // z component of the primary vertex
+      forest::Scalar<float> _pvRho; // rho of the primary vertex (projection on transverse plane)
+      // centrality
+      forest::Scalar<int> _hiBin; // centrality bin (-1 if not available)
+      forest::Scalar<float> _hiHF; // transverse energy sum of the HF towers
+      forest::Scalar<float> _hiHFplus; // HF tower transverse energy sum, positive side
+      forest::Scalar<float> _hiHFminus; // HF tower transverse energy sum, negative side
 };
 
 //
@@ -158,7 +223,30 @@ double _massEl = 0.000511;
 //
 // constructor
 //
-Analyzer::Analyzer(const edm::ParameterSet& iConfig)
+Analyzer::Analyzer(const edm::ParameterSet& iConfig) :
+  _evRunNumber(_columns, "evRunNumber"),
+  _evEventNumber(_columns, "evEventNumber"),
+  _evSeq(_columns, "evSeq"),
+  _Nmu(_columns, "Nmu"),
+  _muPt(_columns, _Nmu, "muPt"),
+  _muEta(_columns, _Nmu, "muEta"),
+  _muPhi(_columns, _Nmu, "muPhi"),
+  _muC(_columns, _Nmu, "muC"),
+  _muIso03(_columns, _Nmu, "muIso03"),
+  _muIso04(_columns, _Nmu, "muIso04"),
+  _muHitsValid(_columns, _Nmu, "muHitsValid"),
+  _muHitsPixel(_columns, _Nmu, "muHitsPixel"),
+  _muDistPV0(_columns, _Nmu, "muDistPV0"),
+  _muDistPVz(_columns, _Nmu, "muDistPVz"),
+  _muTrackChi2NDOF(_columns, _Nmu, "muTrackChi2NDOF"),
+  _Npv(_columns, "Npv"),
+  _pvNDOF(_columns, "pvNDOF"),
+  _pvZ(_columns, "pvZ"),
+  _pvRho(_columns, "pvRho"),
+  _hiBin(_columns, "hiBin", -1),
+  _hiHF(_columns, "hiHF"),
+  _hiHFplus(_columns, "hiHFplus"),
+  _hiHFminus(_columns, "hiHFminus")
 {
   // for proper log files writing (immediate output)
   setbuf(stdout, NULL);
@@ -175,45 +263,78 @@ Analyzer::Analyzer(const edm::ParameterSet& iConfig)
   _flagGEN = 0;//iConfig.getParameter<int>("gen"); // if true, generator level processed (works only for MC)
   _nevents = 0; // number of processed events
   _neventsSelected = 0; // number of selected events
-  edm::Service<TFileService> fs;
-  _tree = fs->make<TTree>("Muons", "Muons"); //make output tree
+  _flagCentrality = iConfig.getUntrackedParameter<bool>("centrality", false); // if true, centrality bin and HF sums are filled
+  _centrality = 0;
+  _nCentralityMissing = 0;
+  _histogramMode = iConfig.getUntrackedParameter<bool>("histogramMode", false); // if true, only dimuon histograms are written
+  _tree = 0;
+  _mixer = 0;
+  if(_histogramMode)
+  {
+    BookDimuonHists(iConfig);
+    return;
+  }
+  _partitionEdges = iConfig.getUntrackedParameter<std::vector<int> >("centralityPartition", std::vector<int>());
+  if(_partitionEdges.size() == 1 || (!_partitionEdges.empty() && !_flagCentrality))
+    throw cms::Exception("Configuration") << "centralityPartition needs centrality = True and at least two bin edges";
 
   // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
   // >>>>>>> tree branches >>>>>>>>>>>>
   // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
   //
-  // event
-  _tree->Branch("evRunNumber", &_evRunNumber, "evRunNumber/I"); // run number
-  _tree->Branch("evEventNumber", &_evEventNumber, "evEventNumber/I"); // event number
-
-  if(_flagRECO)
+  // RECO level columns
+  if(!_flagRECO)
   {
-    // muons
-    _tree->Branch("Nmu", &_Nmu, "Nmu/I"); // number of muons 
-    _tree->Branch("muPt", _muPt, "muPt[Nmu]/F"); // muon pT
-    _tree->Branch("muEta", _muEta, "muEta[Nmu]/F"); // muon pseudorapidity
-    _tree->Branch("muPhi", _muPhi, "muPhi[Nmu]/F"); // muon phi
-    _tree->Branch("muC", _muC, "muC[Nmu]/F"); // muon phi
-    _tree->Branch("muIso03", _muIso03, "muIso03[Nmu]/F"); // muon isolation, delta_R=0.3
-    _tree->Branch("muIso04", _muIso04, "muIso04[Nmu]/F"); // muon isolation, delta_R=0.4
-    _tree->Branch("muHitsValid", _muHitsValid, "muHitsValid[Nmu]/I"); // muon valid hits number
-    _tree->Branch("muHitsPixel", _muHitsPixel, "muHitsPixel[Nmu]/I"); // muon pixel hits number
-    _tree->Branch("muDistPV0", _muDistPV0, "muDistPV0[Nmu]/F"); // muon distance to the primary vertex (projection on transverse plane)
-    _tree->Branch("muDistPVz", _muDistPVz, "muDistPVz[Nmu]/F"); // muon distance to the primary vertex (z projection)
-    _tree->Branch("muTrackChi2NDOF", _muTrackChi2NDOF, "muTrackChi2NDOF[Nmu]/F"); // muon track number of degrees of freedom
-    // primary vertex
-    _tree->Branch("Npv", &_Npv, "Npv/I"); // total number of primary vertices
-    _tree->Branch("pvNDOF", &_pvNDOF, "pvNDOF/I"); // number of degrees of freedom of the primary vertex
-    _tree->Branch("pvZ", &_pvZ, "pvZ/F"); // z component of the primary vertex
-    _tree->Branch("pvRho", &_pvRho, "pvRho/F"); // rho of the primary vertex (projection on transverse plane)
+    _columns.setEnabled("Nmu", false);
+    _columns.setEnabled("mu*", false);
+    _columns.setEnabled("Npv", false);
+    _columns.setEnabled("pv*", false);
+  }
+  _columns.setEnabled("hi*", _flagCentrality);
+  _columns.setEnabled("evSeq", !_partitionEdges.empty());
+  // columns dropped in the configuration (exact names or 'prefix*'), e.g. dropColumns = cms.untracked.vstring("muIso*")
+  std::vector<std::string> dropColumns = iConfig.getUntrackedParameter<std::vector<std::string> >("dropColumns", std::vector<std::string>());
+  for(unsigned i = 0; i < dropColumns.size(); i++)
+  {
+    if(_columns.setEnabled(dropColumns[i], false) == 0)
+      printf("Analyzer: no column matches '%s' in dropColumns\n", dropColumns[i].c_str());
+  }
+  // make output tree(s); counters of enabled arrays are always kept
+  edm::Service<TFileService> fs;
+  if(_partitionEdges.empty())
+  {
+    _tree = fs->make<TTree>("Muons", "Muons");
+    _columns.book(_tree);
+  }
+  else
+  {
+    // one tree per centrality class, the class is also stored in the tree user info;
+    // the first and last classes take all hiBin values below/above the edges
+    for(unsigned i = 0; i + 1 < _partitionEdges.size(); i++)
+    {
+      int low = (i == 0) ? std::min(_partitionEdges[i], -1) : _partitionEdges[i];
+      int high = (i + 2 == _partitionEdges.size()) ? std::numeric_limits<int>::max() : _partitionEdges[i + 1];
+      std::string title = (i + 2 == _partitionEdges.size()) ? Form("Muons, %d <= hiBin", low) : Form("Muons, %d <= hiBin < %d", low, high);
+      TTree* tree = fs->make<TTree>(Form("Muons_hiBin%dto%d", _partitionEdges[i], _partitionEdges[i + 1]), title.c_str());
+      tree->GetUserInfo()->Add(new TParameter<int>("hiBinLow", low));
+      tree->GetUserInfo()->Add(new TParameter<int>("hiBinHigh", high));
+      _columns.book(tree);
+      _partitionTrees.push_back(tree);
+    }
+  }
+  for(unsigned i = 0; i < _columns.size(); i++)
+  {
+    if(!_columns[i].enabled())
+      printf("Analyzer: column %s is not written\n", _columns[i].name().c_str());
   }
-
 }
 
 
 // destructor
 Analyzer::~Analyzer()
 {
+  delete _mixer;
+  delete _centrality;
 }
 
 
@@ -224,13 +345,119 @@ Analyzer::~Analyzer()
 // initialise event variables with needed default (zero) values; called in the beginning of each event
 void Analyzer::InitBranchVars()
 {
-  _evRunNumber = 0;
-  _evEventNumber = 0;
-  _Nmu = 0;
-  _Npv= 0;
-  _pvNDOF = 0;
-  _pvZ = 0;
-  _pvRho = 0;
+  _columns.reset();
+}
+
+// book the histograms and read the dimuon selection for histogram mode; the
+// histograms are simple sums, so the outputs of several jobs can be added
+void Analyzer::BookDimuonHists(const edm::ParameterSet& iConfig)
+{
+  edm::ParameterSet selection = iConfig.getParameter<edm::ParameterSet>("dimuonSelection");
+  _triggerName = selection.getParameter<std::string>("triggerName"); // '' for no trigger requirement
+  _inputTagTriggerResults = selection.getParameter<edm::InputTag>("triggerResults");
+  _muMinHitsValid = selection.getParameter<int>("minHitsValid");
+  _muMinHitsPixel = selection.getParameter<int>("minHitsPixel");
+  _muMaxTrackChi2NDOF = selection.getParameter<double>("maxTrackChi2NDOF");
+  _muMaxDistPV0 = selection.getParameter<double>("maxDistPV0");
+  _muMinPt = selection.getParameter<double>("minPt");
+  _muMaxAbsEta = selection.getParameter<double>("maxAbsEta");
+
+  // event mixing: pools of 'depth' events per bin of vertex z and event class, the centrality bin
+  // if centrality is filled and the stored muon multiplicity (Nmu) otherwise (depth 0: no mixing)
+  edm::ParameterSet mixing = iConfig.getParameter<edm::ParameterSet>("dimuonMixing");
+  int mixingDepth = mixing.getParameter<int>("depth");
+  if(mixingDepth > 0)
+    _mixer = new forest::DimuonMixer(mixing.getParameter<std::vector<double> >("zBins"),
+                                     mixing.getParameter<std::vector<double> >(_flagCentrality ? "centralityBins" : "multiplicityBins"),
+                                     mixingDepth, _maxNmu);
+
+  edm::Service<TFileService> fs;
+  std::vector<edm::ParameterSet> hists = iConfig.getParameter<std::vector<edm::ParameterSet> >("histograms");
+  for(unsigned i = 0; i < hists.size(); i++)
+  {
+    std::string name = hists[i].getParameter<std::string>("name");
+    std::string variable = hists[i].getParameter<std::string>("variable");
+    DimuonVariable var;
+    if(variable == "mass")
+      var = kDimuMass;
+    else if(variable == "pt")
+      var = kDimuPt;
+    else if(variable == "rapidity")
+      var = kDimuRapidity;
+    else
+      throw cms::Exception("Configuration") << "histogram " << name << ": unknown dimuon variable '" << variable << "' (mass, pt or rapidity)";
+    std::string title = hists[i].getParameter<std::string>("title");
+    int nbins = hists[i].getParameter<int>("nbins");
+    double min = hists[i].getParameter<double>("min");
+    double max = hists[i].getParameter<double>("max");
+    TH1F* h = fs->make<TH1F>(name.c_str(), title.c_str(), nbins, min, max);
+    h->Sumw2();
+    _dimuHists.hists.push_back(h);
+    _dimuHists.variables.push_back(var);
+    // same histogram for mixed events
+    if(mixingDepth > 0)
+    {
+      h = fs->make<TH1F>((name + "_mix").c_str(), title.c_str(), nbins, min, max);
+      h->Sumw2();
+      _dimuMixHists.hists.push_back(h);
+      _dimuMixHists.variables.push_back(var);
+    }
+  }
+}
+
+// trigger decision (same as in TriggerInfoAnalyzer): the configured path accepted the event
+bool Analyzer::PassTrigger(const edm::Event& iEvent)
+{
+  if(_triggerName.empty())
+    return true;
+  edm::Handle<edm::TriggerResults> triggerResults;
+  iEvent.getByLabel(_inputTagTriggerResults, triggerResults);
+  if(!triggerResults.isValid())
+    return false;
+  const edm::TriggerNames& triggerNames = iEvent.triggerNames(*triggerResults);
+  unsigned int index = triggerNames.triggerIndex(_triggerName);
+  return index < triggerNames.size() && triggerResults->accept(index);
+}
+
+// muon selection of forest2dimuon.C for muon i of the event
+bool Analyzer::PassDimuonMu(int i)
+{
+  if(_muHitsValid[i] < _muMinHitsValid) return false;
+  if(_muHitsPixel[i] < _muMinHitsPixel) return false;
+  if(_muTrackChi2NDOF[i] > _muMaxTrackChi2NDOF) return false;
+  if(_muDistPV0[i] > _muMaxDistPV0) return false;
+  if(_muPt[i] < _muMinPt) return false;
+  if(TMath::Abs(_muEta[i]) > _muMaxAbsEta) return false;
+  return true;
+}
+
+// fill the histograms with all opposite sign pairs of selected muons, and the
+// mixed event histograms with the pairs of selected muons with the event pool
+void Analyzer::FillDimuonHists()
+{
+  forest::MixMuon selected[_maxNmu];
+  int nSelected = 0;
+  for(int i = 0; i < _Nmu; i++)
+  {
+    if(PassDimuonMu(i))
+      selected[nSelected++] = forest::MixMuon::fromPtEtaPhi(_muPt[i], _muEta[i], _muPhi[i], _massMu, int(_muC[i]));
+  }
+  for(int i = 1; i < nSelected; i++)
+  {
+    for(int j = 0; j < i; j++)
+    {
+      if(selected[i].charge * selected[j].charge < 0)
+        _dimuHists(selected[i], selected[j]);
+    }
+  }
+  // events without primary vertex are not mixed
+  if(!_mixer || _Npv == 0)
+    return;
+  _mixer->beginEvent(_pvZ, _flagCentrality ? int(_hiBin) : int(_Nmu));
+  for(int i = 0; i < nSelected; i++)
+    _mixer->addMuon(selected[i]);
+  _mixer->mix(_dimuMixHists);
+  _mixer->endEvent();
 }
 
 // Store event info (fill corresponding tree variables)
@@ -256,23 +483,25 @@ int Analyzer::SelectMu(const edm::Handle<reco::TrackCollection>& muons, const re
       printf("Maximum number of muons %d reached, skipping the rest\n", _maxNmu);
       return 0;
     }
-    _muHitsValid[_Nmu] = 0;
-    _muHitsPixel[_Nmu] = 0;
-    const reco::HitPattern& p = it->hitPattern();
-    for (int i = 0; i < p.numberOfHits(); i++) 
+    // count hits (the hit pattern loop is skipped if neither column is written)
+    if (_muHitsValid.enabled() || _muHitsPixel.enabled())
     {
-      uint32_t hit = p.getHitPattern(i);
-      if (p.validHitFilter(hit) && p.pixelHitFilter(hit))
-        _muHitsPixel[_Nmu]++;
-      if (p.validHitFilter(hit))
-        _muHitsValid[_Nmu]++;
+      const reco::HitPattern& p = it->hitPattern();
+      for (int i = 0; i < p.numberOfHits(); i++) 
+      {
+        uint32_t hit = p.getHitPattern(i);
+        if (p.validHitFilter(hit) && p.pixelHitFilter(hit))
+          _muHitsPixel[_Nmu]++;
+        if (p.validHitFilter(hit))
+          _muHitsValid[_Nmu]++;
+      }
     }
     // fill three momentum (pT, eta, phi)
     _muPt[_Nmu] = it->pt();// * it->charge();
     _muEta[_Nmu] = it->eta();
     _muPhi[_Nmu] = it->phi();
     _muC[_Nmu]=it->charge();
-    // fill chi2/ndof
+    // fill chi2/ndof (stays at its default of zero if ndof is zero)
     if (it->ndof()) _muTrackChi2NDOF[_Nmu] = it->chi2() / it->ndof();
     // fill distance to primary vertex
     _muDistPV0[_Nmu] = TMath::Sqrt(TMath::Power(pv->x() - it->vx(), 2.0) + TMath::Power(pv->y() - it->vy(), 2.0));
@@ -308,6 +537,45 @@ int Analyzer::SelectPrimaryVertex(const edm::Handle<reco::VertexCollection>& pri
   return true;
 }
 
+// fill centrality bin and HF energy sums
+// (without centrality product or table the event is kept with hiBin = -1, so
+// that the Muons tree stays aligned with HltTree)
+int Analyzer::SelectCentrality(const edm::Event& iEvent, const edm::EventSetup& iSetup)
+{
+  try
+  {
+    // the centrality table is read from the conditions, so this can only be done once events are processed
+    if(!_centrality)
+      _centrality = new CentralityProvider(iSetup);
+    _centrality->newEvent(iEvent, iSetup);
+    const reco::Centrality* centrality = _centrality->raw();
+    _hiBin = _centrality->getBin();
+    _hiHF = centrality->EtHFtowerSum();
+    _hiHFplus = centrality->EtHFtowerSumPlus();
+    _hiHFminus = centrality->EtHFtowerSumMinus();
+  }
+  catch(cms::Exception& e)
+  {
+    if(_nCentralityMissing++ == 0)
+      printf("Analyzer: no centrality, hiBin = -1 (reported only once):\n%s\n", e.what());
+    _hiBin = -1;
+    _hiHF = 0;
+    _hiHFplus = 0;
+    _hiHFminus = 0;
+    return 1;
+  }
+  return 0;
+}
+
+// tree of the centrality class of the event (centrality partitioned output)
+TTree* Analyzer::PartitionTree()
+{
+  unsigned i = 0;
+  while(i + 1 < _partitionTrees.size() && _hiBin >= _partitionEdges[i + 1])
+    i++;
+  return _partitionTrees[i];
+}
+
 // fill 4-momentum (p) with provided particle pointer
 void Analyzer::FillFourMomentum(const reco::Candidate* particle, float* p)
 {
@@ -368,10 +636,33 @@ void Analyzer::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup)
     // fill primary vertex
     SelectPrimaryVertex(primVertex);
   }
+  // fill centrality, if needed
+  if(_flagCentrality)
+    SelectCentrality(iEvent, iSetup);
   // fill event info
   SelectEvent(iEvent);
+  // histogram mode: fill histograms for triggered events, nothing is stored
+  if(_histogramMode)
+  {
+    if(PassTrigger(iEvent))
+    {
+      FillDimuonHists();
+      _neventsSelected++;
+    }
+    return;
+  }
   // all done: store event
-  _tree->Fill();
+  if(_partitionTrees.empty())
+    _tree->Fill();
+  else
+  {
+    // each event goes to exactly one class tree, so their entries add up to the event sequence number
+    Long64_t seq = 0;
+    for(unsigned i = 0; i < _partitionTrees.size(); i++)
+      seq += _partitionTrees[i]->GetEntries();
+    _evSeq = seq;
+    PartitionTree()->Fill();
+  }
   _neventsSelected++;
 }
 
@@ -6,13 +6,25 @@
 #include "FWCore/Framework/interface/EDAnalyzer.h"
 
 #include "FWCore/Framework/interface/Event.h"
+#include "FWCore/Framework/interface/LuminosityBlock.h"
+#include "FWCore/Framework/interface/FileBlock.h"
 #include "FWCore/Framework/interface/MakerMacros.h"
 
 #include "FWCore/ParameterSet/interface/ParameterSet.h"
+#include "FWCore/Utilities/interface/Exception.h"
 #include "CommonTools/UtilAlgos/interface/TFileService.h"
 #include "FWCore/ServiceRegistry/interface/Service.h"
 #include "TH1.h"
 #include "TTree.h"
+#include "TFile.h"
+#include "TDirectory.h"
+#include "TROOT.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdint.h>
 
 //
 // class declaration
@@ -35,6 +47,17 @@ private:
   virtual void endRun(edm::Run const&, edm::EventSetup const&);
   virtual void beginLuminosityBlock(edm::LuminosityBlock const&, edm::EventSetup const&);
   virtual void endLuminosityBlock(edm::LuminosityBlock const&, edm::EventSetup const&);
+  virtual void respondToOpenInputFile(edm::FileBlock const&);
+  virtual void respondToCloseInputFile(edm::FileBlock const&);
+
+  void commitCheckpoint(edm::LuminosityBlock const&);
+  void rotateOutput();
+  void closeOutput();
+  void fillInputLumis();
+  void writeIndexSegment(std::ostream& out, unsigned firstFile, unsigned firstRecord);
+  void appendEventIndex();
+  void writeEventIndex();
+  TFile* currentFile() { return outputPart_ ? outputPart_ : &fs->file(); }
 
   // ----------member data ---------------------------
 
@@ -45,6 +68,56 @@ private:
   TTree* HiForestVersionTree;
   std::string HiForestVersion_;
   std::string GlobalTagLabel_;
+  std::string ConfigHash_;
+  std::string CacheKey_;
+
+  // checkpointing: output is committed at every lumi boundary and the
+  // committed lumis/input files are listed in the manifest
+  std::string checkpointManifest_;
+  std::ofstream checkpoint_;
+  std::vector<std::string> closedInputFiles_;
+
+  // output rotation: at a lumi boundary the output moves on to a new file
+  // once one of the limits (0 = no limit) is reached
+  int maxFileSize_;       // MB
+  int maxEventsPerFile_;
+  int maxLumisPerFile_;
+  TFile* outputPart_;     // current output file after the first rotation (0 before)
+  int outputPartNumber_;
+  int eventsInFile_;
+  int lumisInFile_;
+
+  // per-file lumi summary
+  TTree* LumiSummaryTree;
+  int lumiRun_;
+  int lumiNumber_;
+  int lumiEvents_;
+
+  // lumi ranges processed from each input file
+  TTree* InputFilesTree;
+  char inputFileName_[4096];
+  int inputRun_;
+  int inputFirstLumi_;
+  int inputLastLumi_;
+  std::set<std::pair<int,int> > inputLumis_;
+
+  // event index: input file of every event, sorted by (run, event, lumi)
+  struct EventIndexRecord {
+    uint32_t run, lumi, event, file;
+    bool operator<(const EventIndexRecord& other) const {
+      if (run != other.run) return run < other.run;
+      if (event != other.event) return event < other.event;
+      return lumi < other.lumi;
+    }
+  };
+  std::string eventIndex_;
+  std::vector<EventIndexRecord> eventRecords_;
+  std::vector<std::string> indexFiles_;
+  std::ofstream eventIndexOut_;  // index appended at checkpoint commits
+  unsigned indexedRecords_;      // events and input files already appended
+  unsigned indexedFiles_;
+  std::map<std::string, uint32_t> indexFileNumbers_;
+  uint32_t currentIndexFile_;
 };
 
 //
@@ -63,6 +136,22 @@ HiForestInfo::HiForestInfo(const edm::ParameterSet& iConfig)
   inputLines_ = iConfig.getParameter<std::vector<std::string> >("inputLines");
   HiForestVersion_ = iConfig.getParameter<std::string>("HiForestVersion");
   GlobalTagLabel_ = iConfig.getParameter<std::string>("GlobalTagLabel");
+  ConfigHash_ = iConfig.getParameter<std::string>("ConfigHash");
+  CacheKey_ = iConfig.getParameter<std::string>("CacheKey");
+  checkpointManifest_ = iConfig.getUntrackedParameter<std::string>("checkpointManifest", "");
+  maxFileSize_ = iConfig.getUntrackedParameter<int>("maxFileSize", 0);
+  maxEventsPerFile_ = iConfig.getUntrackedParameter<int>("maxEventsPerFile", 0);
+  maxLumisPerFile_ = iConfig.getUntrackedParameter<int>("maxLumisPerFile", 0);
+  eventIndex_ = iConfig.getUntrackedParameter<std::string>("eventIndex", "");
+  outputPart_ = 0;
+  outputPartNumber_ = 0;
+  eventsInFile_ = 0;
+  lumisInFile_ = 0;
+  lumiEvents_ = 0;
+  inputFileName_[0] = 0;
+  indexedRecords_ = 0;
+  indexedFiles_ = 0;
+  currentIndexFile_ = 0;
 }
 
 
@@ -79,12 +168,255 @@ HiForestInfo::~HiForestInfo()
 // member functions
 //
 
+// Write all trees and other objects booked in dir (and its subdirectories)
+// together with the directory headers, so that the file can be recovered up
+// to this point even if the job is killed later on.
+static void commitDirectory(TDirectory* dir)
+{
+  TIter next(dir->GetList());
+  while (TObject* obj = next()) {
+    if (obj->InheritsFrom(TDirectory::Class())) {
+      commitDirectory((TDirectory*)obj);
+    } else if (obj->InheritsFrom(TTree::Class())) {
+      ((TTree*)obj)->AutoSave("SaveSelf");
+    } else {
+      dir->cd();
+      obj->Write("", TObject::kOverwrite);
+    }
+  }
+  dir->SaveSelf(kTRUE);
+}
+
+// Switch off ROOT's own autosave (every ~300 MB per tree) for all trees in
+// dir, so that tree headers are only written at commits: a recovered file
+// then holds exactly the committed lumis, with the same entries in all trees.
+static void disableAutoSave(TDirectory* dir)
+{
+  TIter next(dir->GetList());
+  while (TObject* obj = next()) {
+    if (obj->InheritsFrom(TDirectory::Class()))
+      disableAutoSave((TDirectory*)obj);
+    else if (obj->InheritsFrom(TTree::Class()))
+      ((TTree*)obj)->SetAutoSave((Long64_t)1 << 50);
+  }
+}
+
+// Move everything booked in dir to newDir (0: detach from any file).
+// Trees and histograms are written to the old file first and restart empty,
+// other objects are written and carried over as they are.
+static void moveDirectory(TDirectory* dir, TDirectory* newDir)
+{
+  // copy the list, it changes while objects are moved
+  std::vector<TObject*> objects;
+  TIter next(dir->GetList());
+  while (TObject* obj = next())
+    objects.push_back(obj);
+
+  for (unsigned i = 0; i < objects.size(); ++i) {
+    TObject* obj = objects[i];
+    if (obj->InheritsFrom(TDirectory::Class())) {
+      TDirectory* newSub = newDir ? newDir->mkdir(obj->GetName(), obj->GetTitle()) : 0;
+      moveDirectory((TDirectory*)obj, newSub);
+      continue;
+    }
+    dir->cd();
+    obj->Write("", TObject::kOverwrite);
+    if (obj->InheritsFrom(TTree::Class())) {
+      TTree* tree = (TTree*)obj;
+      if (newDir)
+        tree->Reset();
+      tree->SetDirectory(newDir);
+    } else if (obj->InheritsFrom(TH1::Class())) {
+      TH1* hist = (TH1*)obj;
+      if (newDir)
+        hist->Reset();
+      hist->SetDirectory(newDir);
+    } else {
+      dir->Remove(obj);
+      if (newDir)
+        newDir->Append(obj);
+    }
+  }
+  dir->SaveSelf(kTRUE);
+}
+
+// ------------ continue the output in a new file  ------------
+// The new file is named after the TFileService one with a '_<N>' suffix. All
+// forest trees and histograms keep their addresses, so the other modules are
+// not affected; each file gets its own HiForestInfo entry and lumi summary.
+void
+HiForestInfo::rotateOutput()
+{
+  std::string name = fs->file().GetName();
+  std::string::size_type dot = name.rfind(".root");
+  if (dot == std::string::npos) dot = name.size();
+  ++outputPartNumber_;
+  name = Form("%s_%d%s", name.substr(0, dot).c_str(), outputPartNumber_, name.substr(dot).c_str());
+
+  TDirectory* saved = gDirectory;
+  TFile* newFile = TFile::Open(name.c_str(), "RECREATE");
+  if (!newFile || newFile->IsZombie())
+    throw cms::Exception("FileOpenError") << "cannot create forest output file " << name;
+  newFile->SetCompressionLevel(currentFile()->GetCompressionLevel());
+  fillInputLumis(); // the current input continues in the new file
+  moveDirectory(currentFile(), newFile);
+  if (outputPart_) {
+    if (saved->GetFile() == outputPart_) saved = newFile;
+    outputPart_->Close();
+    delete outputPart_;
+  }
+  outputPart_ = newFile;
+  saved->cd();
+
+  HiForestVersionTree->Fill();
+  eventsInFile_ = 0;
+  lumisInFile_ = 0;
+  if (checkpoint_.is_open())
+    checkpoint_ << "output " << name << std::endl;
+}
+
+// ------------ store the lumi ranges processed from the current input file  ------------
+void
+HiForestInfo::fillInputLumis()
+{
+  std::set<std::pair<int,int> >::const_iterator it = inputLumis_.begin();
+  while (it != inputLumis_.end()) {
+    inputRun_ = it->first;
+    inputFirstLumi_ = inputLastLumi_ = it->second;
+    for (++it; it != inputLumis_.end() && it->first == inputRun_ && it->second == inputLastLumi_ + 1; ++it)
+      inputLastLumi_ = it->second;
+    InputFilesTree->Fill();
+  }
+  inputLumis_.clear();
+}
+
+// ------------ write and close the last output file of the job  ------------
+void
+HiForestInfo::closeOutput()
+{
+  if (!outputPart_) return; // the TFileService file is written by the service
+  TDirectory* saved = gDirectory;
+  // the objects stay valid (detached) for modules finishing after us
+  moveDirectory(outputPart_, 0);
+  if (saved->GetFile() == outputPart_) saved = gROOT;
+  outputPart_->Close();
+  delete outputPart_;
+  outputPart_ = 0;
+  saved->cd();
+}
+
+// ------------ write the event index  ------------
+// Binary file for memory mapping (little endian on any machine, see pickEvents.py):
+//   "HFEVIDX1", followed by segments of
+//     uint32 number of new input files, per file: uint32 name length, name
+//     uint32 number of events, per event: uint32 run, lumi, event, input file
+//     number (16 bytes), sorted by (run, event, lumi)
+// Input files are numbered in order of appearance over all segments. With
+// checkpointing, the events of each committed lumi are appended as a segment
+// (a reader ignores a truncated last one); at the end of the job the index is
+// rewritten as one sorted segment.
+static void appendLittleEndian(std::string& buffer, uint32_t value)
+{
+  for (int i = 0; i < 4; ++i)
+    buffer += char((value >> (8 * i)) & 0xff);
+}
+
+void
+HiForestInfo::writeIndexSegment(std::ostream& out, unsigned firstFile, unsigned firstRecord)
+{
+  std::string buffer;
+  appendLittleEndian(buffer, indexFiles_.size() - firstFile);
+  for (unsigned i = firstFile; i < indexFiles_.size(); ++i) {
+    appendLittleEndian(buffer, indexFiles_[i].size());
+    buffer += indexFiles_[i];
+  }
+  appendLittleEndian(buffer, eventRecords_.size() - firstRecord);
+  buffer.reserve(buffer.size() + (eventRecords_.size() - firstRecord) * 16);
+  for (unsigned i = firstRecord; i < eventRecords_.size(); ++i) {
+    appendLittleEndian(buffer, eventRecords_[i].run);
+    appendLittleEndian(buffer, eventRecords_[i].lumi);
+    appendLittleEndian(buffer, eventRecords_[i].event);
+    appendLittleEndian(buffer, eventRecords_[i].file);
+  }
+  out.write(buffer.data(), buffer.size());
+}
+
+// ------------ append the events since the last commit to the event index  ------------
+void
+HiForestInfo::appendEventIndex()
+{
+  if (!eventIndexOut_.is_open()) {
+    eventIndexOut_.open(eventIndex_.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    eventIndexOut_.write("HFEVIDX1", 8);
+  }
+  std::sort(eventRecords_.begin() + indexedRecords_, eventRecords_.end());
+  writeIndexSegment(eventIndexOut_, indexedFiles_, indexedRecords_);
+  eventIndexOut_.flush();
+  if (!eventIndexOut_)
+    throw cms::Exception("FileWriteError") << "cannot write event index " << eventIndex_;
+  indexedRecords_ = eventRecords_.size();
+  indexedFiles_ = indexFiles_.size();
+}
+
+// ------------ write the complete event index (one segment)  ------------
+// written to a temporary file first, replacing the appended one at once
+void
+HiForestInfo::writeEventIndex()
+{
+  if (eventIndexOut_.is_open())
+    eventIndexOut_.close();
+  std::sort(eventRecords_.begin(), eventRecords_.end());
+
+  std::string tmpName = eventIndex_ + ".tmp";
+  std::ofstream out(tmpName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  out.write("HFEVIDX1", 8);
+  writeIndexSegment(out, 0, 0);
+  out.close();
+  if (!out || std::rename(tmpName.c_str(), eventIndex_.c_str()) != 0)
+    throw cms::Exception("FileWriteError") << "cannot write event index " << eventIndex_;
+}
+
+// ------------ commit the output and record the lumi in the checkpoint manifest  ------------
+// Manifest lines are
+//   output <file>        output file written by this job
+//   key <CacheKey>       production key of this job
+//   index <file>         event index written by this job
+//   lumi <run> <lumi>    lumi section fully contained in the committed output
+//   file <name>          input file fully contained in the committed output
+//   done                 job finished normally
+// A lumi cut short by maxEvents is ended (and listed) like a complete one, so
+// the manifest is only meaningful for jobs without an event limit.
+void
+HiForestInfo::commitCheckpoint(edm::LuminosityBlock const& iLumi)
+{
+  TDirectory* saved = gDirectory;
+  commitDirectory(currentFile());
+  saved->cd();
+
+  checkpoint_ << "lumi " << iLumi.run() << " " << iLumi.luminosityBlock() << "\n";
+  // input files closed before this lumi ended are only complete now
+  for (unsigned i = 0; i < closedInputFiles_.size(); ++i)
+    checkpoint_ << "file " << closedInputFiles_[i] << "\n";
+  closedInputFiles_.clear();
+  checkpoint_.flush();
+
+  // keep the index in step with the committed output
+  if (!eventIndex_.empty())
+    appendEventIndex();
+}
+
 // ------------ method called for each event  ------------
 void
 HiForestInfo::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup)
 {
   using namespace edm;
-
+  ++lumiEvents_;
+  ++eventsInFile_;
+  inputLumis_.insert(std::make_pair((int)iEvent.id().run(), (int)iEvent.luminosityBlock()));
+  if (!eventIndex_.empty()) {
+    EventIndexRecord record = { iEvent.id().run(), iEvent.luminosityBlock(), iEvent.id().event(), currentIndexFile_ };
+    eventRecords_.push_back(record);
+  }
 }
 
 
@@ -110,13 +442,53 @@ HiForestInfo::beginJob()
   std::strcpy(GlobalTagLabel_c, GlobalTagLabel_.c_str());
   HiForestVersionTree->Branch("GlobalTag",GlobalTagLabel_c,"GlobalTag/C");
 
+  char *ConfigHash_c = new char[ConfigHash_.length()+1];
+  std::strcpy(ConfigHash_c, ConfigHash_.c_str());
+  HiForestVersionTree->Branch("ConfigHash",ConfigHash_c,"ConfigHash/C");
+
+  char *CacheKey_c = new char[CacheKey_.length()+1];
+  std::strcpy(CacheKey_c, CacheKey_.c_str());
+  HiForestVersionTree->Branch("CacheKey",CacheKey_c,"CacheKey/C");
+
   HiForestVersionTree->Fill();
+
+  LumiSummaryTree = fs->make<TTree>("LumiSummary","LumiSummary");
+  LumiSummaryTree->Branch("run",&lumiRun_,"run/I");
+  LumiSummaryTree->Branch("lumi",&lumiNumber_,"lumi/I");
+  LumiSummaryTree->Branch("nEvents",&lumiEvents_,"nEvents/I");
+
+  InputFilesTree = fs->make<TTree>("InputFiles","InputFiles");
+  InputFilesTree->Branch("fileName",inputFileName_,"fileName/C");
+  InputFilesTree->Branch("run",&inputRun_,"run/I");
+  InputFilesTree->Branch("firstLumi",&inputFirstLumi_,"firstLumi/I");
+  InputFilesTree->Branch("lastLumi",&inputLastLumi_,"lastLumi/I");
+
+  if (!checkpointManifest_.empty()) {
+    // the trees of all modules are booked by now (in their constructors)
+    disableAutoSave(&fs->file());
+    checkpoint_.open(checkpointManifest_.c_str(), std::ios::out | std::ios::app);
+    if (!checkpoint_)
+      throw cms::Exception("Configuration") << "cannot open checkpoint manifest " << checkpointManifest_;
+    checkpoint_ << "output " << fs->file().GetName() << "\n";
+    checkpoint_ << "key " << CacheKey_ << "\n";
+    if (!eventIndex_.empty())
+      checkpoint_ << "index " << eventIndex_ << "\n";
+    checkpoint_.flush();
+  }
 }
 
 // ------------ method called once each job just after ending the event loop  ------------
 void
 HiForestInfo::endJob()
 {
+  fillInputLumis();
+  closeOutput();
+  if (!eventIndex_.empty())
+    writeEventIndex();
+  if (checkpoint_.is_open()) {
+    checkpoint_ << "done" << std::endl;
+    checkpoint_.close();
+  }
 }
 
 // ------------ method called when starting to processes a run  ------------
@@ -139,8 +511,47 @@ HiForestInfo::beginLuminosityBlock(edm::LuminosityBlock const&, edm::EventSetup
 
 // ------------ method called when ending the processing of a luminosity block  ------------
 void
-HiForestInfo::endLuminosityBlock(edm::LuminosityBlock const&, edm::EventSetup const&)
+HiForestInfo::endLuminosityBlock(edm::LuminosityBlock const& iLumi, edm::EventSetup const&)
+{
+  lumiRun_ = iLumi.run();
+  lumiNumber_ = iLumi.luminosityBlock();
+  LumiSummaryTree->Fill();
+  lumiEvents_ = 0;
+  ++lumisInFile_;
+
+  if (checkpoint_.is_open())
+    commitCheckpoint(iLumi);
+
+  if ((maxFileSize_ > 0 && currentFile()->GetEND() >= (Long64_t)maxFileSize_ * 1024 * 1024) ||
+      (maxEventsPerFile_ > 0 && eventsInFile_ >= maxEventsPerFile_) ||
+      (maxLumisPerFile_ > 0 && lumisInFile_ >= maxLumisPerFile_))
+    rotateOutput();
+}
+
+// ------------ method called when a new input file is opened  ------------
+void
+HiForestInfo::respondToOpenInputFile(edm::FileBlock const& fb)
+{
+  std::strncpy(inputFileName_, fb.fileName().c_str(), sizeof(inputFileName_) - 1);
+  inputFileName_[sizeof(inputFileName_) - 1] = 0;
+
+  std::map<std::string, uint32_t>::const_iterator known = indexFileNumbers_.find(fb.fileName());
+  if (known != indexFileNumbers_.end()) {
+    currentIndexFile_ = known->second;
+  } else {
+    currentIndexFile_ = indexFiles_.size();
+    indexFileNumbers_[fb.fileName()] = currentIndexFile_;
+    indexFiles_.push_back(fb.fileName());
+  }
+}
+
+// ------------ method called when an input file is closed  ------------
+void
+HiForestInfo::respondToCloseInputFile(edm::FileBlock const& fb)
 {
+  fillInputLumis();
+  if (checkpoint_.is_open())
+    closedInputFiles_.push_back(fb.fileName());
 }
 
 // ------------ method fills 'descriptions' with the allowed parameters for the module  ------------